@@ -7,7 +7,8 @@ LDFLAGS="-s -flto -Wl,--gc-sections -ldl"
 
 mkdir -p src src/third_party docs
 
-${CXX} ${CFLAGS} -Isrc -o archive_stub src/archive_main.cpp src/dlz.cpp ${LDFLAGS}
-${CXX} ${CFLAGS} -Isrc -o comp         src/comp.cpp         src/dlz.cpp ${LDFLAGS}
+${CXX} ${CFLAGS} -Isrc -o archive_stub src/archive_main.cpp src/arena.cpp src/dlz.cpp ${LDFLAGS}
+${CXX} ${CFLAGS} -Isrc -o comp         src/comp.cpp  src/encoder.cpp src/arena.cpp src/dlz.cpp ${LDFLAGS}
+${CXX} ${CFLAGS} -Isrc -o sweep        src/sweep.cpp src/encoder.cpp src/arena.cpp src/dlz.cpp ${LDFLAGS} -pthread
 
-echo "[OK] Built comp and archive_stub (dynamic zlib; STORE fallback)."
\ No newline at end of file
+echo "[OK] Built comp, archive_stub and sweep (dynamic zlib; STORE fallback)."
\ No newline at end of file
@@ -4,10 +4,11 @@
 #include <cstring>
 #include <cerrno>
 #include <string>
-#include <vector>
+#include <algorithm>
 #include <sys/stat.h>
 #include <unistd.h>
 #include "dlz.h"
+#include "arena.h"
 
 #if defined(__linux__)
 #include <limits.h>
@@ -62,14 +63,53 @@ static const char* const DICT[] = {
 };
 static constexpr int DICT_SIZE = (int)(sizeof(DICT)/sizeof(DICT[0]));
 
+// Same template parameter keys as compressor (TMPL_KEYS order; code = 0x83 + index with layout byte, 0xC1 + index without)
+static const char* const TMPL_KEYS[] = {
+    // {{cite ...}} / {{citation ...}}
+    "author", "last", "first", "title",
+    "url", "publisher", "date", "accessdate",
+    "access-date", "work", "pages", "page",
+    "isbn", "doi", "issue", "volume",
+    "journal", "language", "archiveurl", "archivedate",
+    "quote", "location", "year", "month",
+    "coauthors", "editor", "format", "id",
+    "newspaper", "authorlink",
+    // {{Infobox ...}}
+    "name", "image", "caption", "image_caption",
+    "birth_date", "birth_place", "death_date", "death_place",
+    "occupation", "nationality", "spouse", "website",
+    "type", "location", "country", "population",
+    "area", "leader_name", "leader_title", "established",
+    "founded", "headquarters", "genre", "label",
+    "years_active", "origin", "released", "producer",
+    "length", "artist", "title", "coordinates"
+};
+static constexpr int TMPL_KEYS_SIZE = (int)(sizeof(TMPL_KEYS)/sizeof(TMPL_KEYS[0]));
+static constexpr unsigned TMPL_CODE_BASE = 0x83;
+static constexpr unsigned TMPL_BARE_BASE = 0xC1;
+
 struct TransformDecoder {
     // Header parsing
     unsigned char hdr[8]; size_t hdr_pos = 0; bool header_done = false; bool transforms = false;
     // Escape decoding state machine
-    enum EscState { ESC_NONE=0, ESC_SEEN00=1, ESC_SPACE=2, ESC_NL=3, ESC_DIGIT_LEN=4, ESC_DIGIT_COPY=5 };
-    EscState esc = ESC_NONE; size_t digit_left = 0;
+    enum EscState { ESC_NONE=0, ESC_SEEN00=1, ESC_SPACE=2, ESC_NL=3, ESC_DIGIT_LEN=4, ESC_DIGIT_COPY=5, ESC_TMPL_LAYOUT=6 };
+    EscState esc = ESC_NONE; size_t digit_left = 0; int tmpl_key = 0;
+    unsigned char* run_buf = nullptr; // RUN_BUF bytes from the arena, used to expand space/newline runs
+    static constexpr size_t RUN_BUF = 259;
 
-    void reset() { hdr_pos = 0; header_done = false; transforms = false; esc = ESC_NONE; digit_left = 0; }
+    void reset() { hdr_pos = 0; header_done = false; transforms = false; esc = ESC_NONE; digit_left = 0; tmpl_key = 0; }
+
+    // '|' [' ' if y&1] key [y>>2 spaces] '=' [' ' if y&2]
+    static bool emit_template_param(int key_id, unsigned y, FILE* fout, uint32_t& crc, uint64_t& written) {
+        unsigned char t[128]; size_t L = 0; const char* key = TMPL_KEYS[key_id]; size_t kl = std::strlen(key);
+        t[L++] = '|'; if (y & 1) t[L++] = ' ';
+        std::memcpy(t + L, key, kl); L += kl;
+        std::memset(t + L, ' ', y >> 2); L += y >> 2;
+        t[L++] = '='; if (y & 2) t[L++] = ' ';
+        if (std::fwrite(t, 1, L, fout) != L) return false;
+        crc = crc32_update(crc, t, L); written += L;
+        return true;
+    }
 
     bool feed(const unsigned char* in, size_t n, FILE* fout, uint32_t& crc, uint64_t& written) {
         size_t i = 0;
@@ -88,7 +128,7 @@ struct TransformDecoder {
                         // HPZT present: need 4 more bytes (ver, flags, pad)
                         while (hdr_pos < 8 && i < n) hdr[hdr_pos++] = in[i++];
                         if (hdr_pos < 8) return true;
-                        header_done = true; transforms = (hdr[5] & 0x0F) != 0;
+                        header_done = true; transforms = (hdr[5] & 0x1F) != 0;
                         continue;
                     }
                 }
@@ -116,16 +156,26 @@ struct TransformDecoder {
                     const char* s = DICT[b - 1]; size_t L = std::strlen(s);
                     if (L) { if (std::fwrite(s, 1, L, fout) != L) return false; crc = crc32_update(crc, (const unsigned char*)s, L); written += L; }
                     esc = ESC_NONE;
+                } else if (b >= TMPL_CODE_BASE && b < TMPL_BARE_BASE && (int)(b - TMPL_CODE_BASE) < TMPL_KEYS_SIZE) {
+                    tmpl_key = b - TMPL_CODE_BASE; esc = ESC_TMPL_LAYOUT;
+                } else if (b >= TMPL_BARE_BASE && (int)(b - TMPL_BARE_BASE) < TMPL_KEYS_SIZE) {
+                    if (!emit_template_param(b - TMPL_BARE_BASE, 0, fout, crc, written)) return false;
+                    esc = ESC_NONE;
                 } else {
                     std::fprintf(stderr, "[ERROR] Invalid transform token: 0x%02x\n", b); return false;
                 }
             } else if (esc == ESC_SPACE) {
-                size_t run = (size_t)b + 4; std::vector<unsigned char> sp(run, (unsigned char)' ');
-                if (!sp.empty()) { if (std::fwrite(sp.data(), 1, sp.size(), fout) != sp.size()) return false; crc = crc32_update(crc, sp.data(), sp.size()); written += sp.size(); }
+                size_t run = (size_t)b + 4; std::memset(run_buf, ' ', run);
+                if (std::fwrite(run_buf, 1, run, fout) != run) return false;
+                crc = crc32_update(crc, run_buf, run); written += run;
                 esc = ESC_NONE;
             } else if (esc == ESC_NL) {
-                size_t run = (size_t)b + 2; std::vector<unsigned char> nl(run, (unsigned char)'\n');
-                if (!nl.empty()) { if (std::fwrite(nl.data(), 1, nl.size(), fout) != nl.size()) return false; crc = crc32_update(crc, nl.data(), nl.size()); written += nl.size(); }
+                size_t run = (size_t)b + 2; std::memset(run_buf, '\n', run);
+                if (std::fwrite(run_buf, 1, run, fout) != run) return false;
+                crc = crc32_update(crc, run_buf, run); written += run;
+                esc = ESC_NONE;
+            } else if (esc == ESC_TMPL_LAYOUT) {
+                if (!emit_template_param(tmpl_key, b, fout, crc, written)) return false;
                 esc = ESC_NONE;
             } else if (esc == ESC_DIGIT_LEN) {
                 digit_left = (size_t)b + 3; esc = ESC_DIGIT_COPY;
@@ -176,35 +226,40 @@ int main(int argc, char** argv) {
 
     const char* out_name = "enwik9.out"; FILE* fout = std::fopen(out_name, "wb"); if (!fout) { std::fprintf(stderr, "[ERROR] Cannot open output %s: %s\n", out_name, std::strerror(errno)); std::fclose(f); return 1; }
 
-    std::vector<unsigned char> inbuf(IN_CHUNK); std::vector<unsigned char> outbuf(OUT_CHUNK);
+    // All large buffers (I/O, run expansion, inflate state) come from one capped arena
+    if (!arena_init(g_arena, ARENA_DEFAULT_CAP)) { std::fprintf(stderr, "[ERROR] Cannot reserve arena.\n"); std::fclose(f); std::fclose(fout); return 1; }
+    unsigned char* inbuf = (unsigned char*)arena_must(g_arena, IN_CHUNK, "input buffer");
+    unsigned char* outbuf = (unsigned char*)arena_must(g_arena, OUT_CHUNK, "output buffer");
     uint64_t written = 0; uint32_t crc = 0u; uint64_t remaining = comp_size;
     TransformDecoder dec; dec.reset();
+    dec.run_buf = (unsigned char*)arena_must(g_arena, TransformDecoder::RUN_BUF, "run buffer");
 
     if (method == METHOD_STORE) {
         while (remaining > 0) {
             size_t to_read = remaining > IN_CHUNK ? IN_CHUNK : (size_t)remaining;
-            size_t r = std::fread(inbuf.data(), 1, to_read, f);
+            size_t r = std::fread(inbuf, 1, to_read, f);
             if (r == 0) { if (!std::feof(f)) { std::fprintf(stderr, "[ERROR] Reading STORE payload failed (%s)\n", std::strerror(errno)); std::fclose(f); std::fclose(fout); return 1; } break; }
             remaining -= r;
-            if (!dec.feed(inbuf.data(), r, fout, crc, written)) { std::fprintf(stderr, "[ERROR] Transform decode failed (STORE).\n"); std::fclose(f); std::fclose(fout); return 1; }
+            if (!dec.feed(inbuf, r, fout, crc, written)) { std::fprintf(stderr, "[ERROR] Transform decode failed (STORE).\n"); std::fclose(f); std::fclose(fout); return 1; }
         }
     } else if (method == METHOD_ZLIB) {
         if (!dlz_available()) { std::fprintf(stderr, "[ERROR] zlib not available for ZLIB payload.\n"); std::fclose(f); std::fclose(fout); return 1; }
-        z_stream strm{}; if (hpz_inflateInit(&strm) != Z_OK) { std::fprintf(stderr, "[ERROR] inflateInit failed\n"); std::fclose(f); std::fclose(fout); return 1; }
+        z_stream strm{}; strm.zalloc = (void*)&arena_zalloc; strm.zfree = (void*)&arena_zfree; strm.opaque = &g_arena;
+        if (hpz_inflateInit(&strm) != Z_OK) { std::fprintf(stderr, "[ERROR] inflateInit failed\n"); std::fclose(f); std::fclose(fout); return 1; }
         int zret = Z_OK;
         while (zret == Z_OK && remaining > 0) {
             size_t to_read = remaining > IN_CHUNK ? IN_CHUNK : (size_t)remaining;
-            size_t r = std::fread(inbuf.data(), 1, to_read, f);
+            size_t r = std::fread(inbuf, 1, to_read, f);
             if (r == 0) { if (!std::feof(f)) { std::fprintf(stderr, "[ERROR] Reading compressed payload failed (%s)\n", std::strerror(errno)); hpz_inflateEnd(&strm); std::fclose(f); std::fclose(fout); return 1; } break; }
             remaining -= r;
-            strm.next_in = inbuf.data(); strm.avail_in = (uInt)r;
+            strm.next_in = inbuf; strm.avail_in = (uInt)r;
             while (strm.avail_in > 0) {
-                strm.next_out = outbuf.data(); strm.avail_out = (uInt)outbuf.size();
+                strm.next_out = outbuf; strm.avail_out = (uInt)OUT_CHUNK;
                 zret = hpz_inflate(&strm, 0);
                 if (zret != Z_OK && zret != Z_STREAM_END) { std::fprintf(stderr, "[ERROR] inflate failed: %d\n", zret); hpz_inflateEnd(&strm); std::fclose(f); std::fclose(fout); return 1; }
-                size_t have = outbuf.size() - strm.avail_out;
+                size_t have = OUT_CHUNK - strm.avail_out;
                 if (have) {
-                    if (!dec.feed(outbuf.data(), have, fout, crc, written)) { std::fprintf(stderr, "[ERROR] Transform decode failed (ZLIB).\n"); hpz_inflateEnd(&strm); std::fclose(f); std::fclose(fout); return 1; }
+                    if (!dec.feed(outbuf, have, fout, crc, written)) { std::fprintf(stderr, "[ERROR] Transform decode failed (ZLIB).\n"); hpz_inflateEnd(&strm); std::fclose(f); std::fclose(fout); return 1; }
                 }
                 if (zret == Z_STREAM_END) break;
             }
@@ -212,12 +267,12 @@ int main(int argc, char** argv) {
         }
         if (zret != Z_STREAM_END) {
             for (;;) {
-                strm.next_out = outbuf.data(); strm.avail_out = (uInt)outbuf.size();
+                strm.next_out = outbuf; strm.avail_out = (uInt)OUT_CHUNK;
                 zret = hpz_inflate(&strm, Z_FINISH);
                 if (zret != Z_OK && zret != Z_STREAM_END) break;
-                size_t have = outbuf.size() - strm.avail_out;
+                size_t have = OUT_CHUNK - strm.avail_out;
                 if (have) {
-                    if (!dec.feed(outbuf.data(), have, fout, crc, written)) { std::fprintf(stderr, "[ERROR] Transform decode failed (finish).\n"); hpz_inflateEnd(&strm); std::fclose(f); std::fclose(fout); return 1; }
+                    if (!dec.feed(outbuf, have, fout, crc, written)) { std::fprintf(stderr, "[ERROR] Transform decode failed (finish).\n"); hpz_inflateEnd(&strm); std::fclose(f); std::fclose(fout); return 1; }
                 }
                 if (zret == Z_STREAM_END) break;
             }
@@ -233,6 +288,7 @@ int main(int argc, char** argv) {
     if (written != orig_size) { std::fprintf(stderr, "[ERROR] Output size mismatch: wrote %llu, expected %llu\n", (unsigned long long)written, (unsigned long long)orig_size); return 1; }
     if (crc != expected_crc) { std::fprintf(stderr, "[ERROR] CRC mismatch: got 0x%08x, expected 0x%08x\n", crc, expected_crc); return 1; }
 
-    std::fprintf(stderr, "[OK] Wrote enwik9.out (%llu bytes)\n", (unsigned long long)written);
+    std::fprintf(stderr, "[OK] Wrote enwik9.out (%llu bytes; arena peak %zu bytes, %s, %llu bytes huge-page backed)\n", (unsigned long long)written, g_arena.peak,
+                 g_arena.huge ? "MADV_HUGEPAGE" : "4 KiB pages", (unsigned long long)arena_huge_bytes());
     return 0;
 }
@@ -0,0 +1,86 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include "arena.h"
+
+static constexpr size_t HUGE_PAGE = 2u << 20;   // 2 MiB
+static constexpr uint64_t MIN_RESERVE = 64u << 20;
+
+Arena g_arena;
+
+static bool thp_mode_allows_madvise() {
+    FILE* f = std::fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r"); if (!f) return false;
+    char buf[128]; size_t n = std::fread(buf, 1, sizeof(buf) - 1, f); std::fclose(f); buf[n] = '\0';
+    return std::strstr(buf, "[always]") || std::strstr(buf, "[madvise]");
+}
+
+bool arena_init(Arena& a, uint64_t cap) {
+    a = Arena();
+    if (cap < ARENA_ALIGN) cap = ARENA_ALIGN;
+    // Over-reserve by one huge page so the usable range can start 2 MiB aligned
+    for (;;) {
+        size_t len = (size_t)cap + HUGE_PAGE;
+        void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p != MAP_FAILED) {
+            uintptr_t aligned = ((uintptr_t)p + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1);
+            a.base = (unsigned char*)aligned; a.cap = (size_t)cap; a.map_len = len;
+            a.mapping = (unsigned char*)p;
+            break;
+        }
+        if (cap / 2 < MIN_RESERVE) { std::perror("mmap arena"); return false; }
+        cap /= 2;
+        std::fprintf(stderr, "[WARN] Arena reservation failed; retrying with %llu bytes\n", (unsigned long long)cap);
+    }
+#if defined(MADV_HUGEPAGE)
+    // madvise() succeeds whenever THP is compiled in, even with the mode set to [never]
+    a.huge = madvise(a.base, a.cap, MADV_HUGEPAGE) == 0 && thp_mode_allows_madvise();
+#endif
+    return true;
+}
+
+uint64_t arena_huge_bytes() {
+    FILE* f = std::fopen("/proc/self/smaps_rollup", "r"); if (!f) return 0;
+    char line[256]; unsigned long long kb = 0;
+    while (std::fgets(line, sizeof(line), f)) {
+        if (std::sscanf(line, "AnonHugePages: %llu kB", &kb) == 1) break;
+    }
+    std::fclose(f);
+    return (uint64_t)kb * 1024;
+}
+
+bool arena_init_sub(Arena& a, Arena& parent, size_t cap) {
+    a = Arena();
+    a.base = (unsigned char*)arena_alloc(parent, cap);
+    if (!a.base) return false;
+    a.cap = cap; a.huge = parent.huge;
+    return true;
+}
+
+void* arena_alloc(Arena& a, size_t n) {
+    size_t off = (a.used + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (off > a.cap || n > a.cap - off) return nullptr;
+    a.used = off + n;
+    if (a.used > a.peak) a.peak = a.used;
+    return a.base + off;
+}
+
+void* arena_must(Arena& a, size_t n, const char* what) {
+    void* p = arena_alloc(a, n);
+    if (!p) {
+        std::fprintf(stderr, "[ERROR] Memory cap exceeded allocating %zu bytes for %s (used %zu of %zu)\n", n, what, a.used, a.cap);
+        std::exit(1);
+    }
+    return p;
+}
+
+void arena_destroy(Arena& a) {
+    if (a.mapping) munmap(a.mapping, a.map_len);
+    a = Arena();
+}
+
+void* arena_zalloc(void* opaque, unsigned items, unsigned size) {
+    return arena_alloc(*(Arena*)opaque, (size_t)items * size);
+}
+
+void arena_zfree(void* opaque, void* p) { (void)opaque; (void)p; }
@@ -0,0 +1,39 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <cstddef>
+#include <cstdint>
+
+// Bump allocator over one up-front mmap reservation (MADV_HUGEPAGE when the kernel accepts
+// it, plain 4 KiB pages otherwise). Frees are no-ops; space is reclaimed with arena_release()
+// back to an earlier arena_mark() or by arena_destroy(). Not thread-safe: give each thread
+// its own sub-arena carved with arena_init_sub().
+static constexpr uint64_t ARENA_DEFAULT_CAP = 10000000000ull; // contest RAM limit (10 GB)
+static constexpr size_t ARENA_ALIGN = 64;
+
+struct Arena {
+    unsigned char* base = nullptr;
+    size_t cap = 0;      // bytes that may be handed out (the memory cap)
+    size_t used = 0;
+    size_t peak = 0;     // high-water mark of used
+    unsigned char* mapping = nullptr; // set when this arena owns the mmap (not a sub-arena)
+    size_t map_len = 0;
+    bool huge = false;   // MADV_HUGEPAGE accepted and the THP mode is always/madvise
+};
+
+extern Arena g_arena;
+
+bool  arena_init(Arena& a, uint64_t cap);
+bool  arena_init_sub(Arena& a, Arena& parent, size_t cap);
+void* arena_alloc(Arena& a, size_t n);
+void* arena_must(Arena& a, size_t n, const char* what); // exits with an error when the cap is hit
+inline size_t arena_mark(const Arena& a) { return a.used; }
+inline void   arena_release(Arena& a, size_t mark) { if (mark < a.used) a.used = mark; }
+inline void   arena_reset_peak(Arena& a) { a.peak = a.used; }
+void  arena_destroy(Arena& a);
+uint64_t arena_huge_bytes(); // AnonHugePages actually backing this process (0 if unknown)
+
+// zlib zalloc/zfree hooks; opaque is the Arena*
+void* arena_zalloc(void* opaque, unsigned items, unsigned size);
+void  arena_zfree(void* opaque, void* p);
+
+#endif
@@ -0,0 +1,255 @@
+#include <algorithm>
+#include "encoder.h"
+
+// Static dictionary of common XML/Wikitext tokens (<=127 entries)
+const char* const DICT[] = {
+    "<page>", "</page>", "<title>", "</title>", "<id>", "</id>",
+    "<revision>", "</revision>", "<timestamp>", "</timestamp>",
+    "<contributor>", "</contributor>", "<username>", "</username>",
+    "<minor/>", "<minor />", "<comment>", "</comment>",
+    "<model>wikitext</model>", "<format>text/x-wiki</format>",
+    "<ns>", "</ns>", "<siteinfo>", "</siteinfo>",
+    "<sitename>", "</sitename>", "<base>", "</base>",
+    "<generator>", "</generator>", "<case>", "</case>",
+    "<namespaces>", "</namespaces>", "<namespace key=\"", "</namespace>",
+    "<mediawiki", "</mediawiki>",
+    "<text xml:space=\"preserve\">", "</text>", "<text ",
+    "[[", "]]", "{{", "}}", "[[Category:", "[[File:", "[[Image:",
+    "<ref>", "</ref>", "<ref", "<!--", "-->",
+    "==", "===", "====", "{{cite", "{{citation", "|author", "|title",
+    "|url", "|publisher", "|date", "|accessdate", "|work", "|pages",
+    "|isbn", "|doi", "|issue", "|volume", "|journal", "|language",
+    "|archiveurl", "|archivedate", "|quote", "|trans-title", "|location",
+    "|ref", "|last", "|first",
+    // Additional common markers
+    "|year", "|month", "|day", "|access-date", "|access-date=",
+    "[[Category:", "{{Infobox", "{{infobox", "<redirect", "#REDIRECT"
+};
+const int DICT_SIZE = (int)(sizeof(DICT)/sizeof(DICT[0]));
+
+DictIndex::DictIndex() {
+    for (int i = 0; i < DICT_SIZE; ++i) {
+        const unsigned char c = (unsigned char)DICT[i][0];
+        heads[c].push_back(i);
+        size_t L = std::strlen(DICT[i]); if (L > maxLen) maxLen = L;
+    }
+    for (int c = 0; c < 256; ++c) {
+        std::sort(heads[c].begin(), heads[c].end(), [](int a, int b){ return std::strlen(DICT[a]) > std::strlen(DICT[b]); });
+    }
+    if (maxLen == 0) maxLen = 1;
+}
+
+// Template parameters folded by TF_TEMPLATE; code = TMPL_CODE_BASE/TMPL_BARE_BASE + index (<=TMPL_MAX_KEYS entries)
+const TemplateKey TMPL_KEYS[] = {
+    // {{cite ...}} / {{citation ...}}
+    {TMPL_CITE, "author"}, {TMPL_CITE, "last"}, {TMPL_CITE, "first"}, {TMPL_CITE, "title"},
+    {TMPL_CITE, "url"}, {TMPL_CITE, "publisher"}, {TMPL_CITE, "date"}, {TMPL_CITE, "accessdate"},
+    {TMPL_CITE, "access-date"}, {TMPL_CITE, "work"}, {TMPL_CITE, "pages"}, {TMPL_CITE, "page"},
+    {TMPL_CITE, "isbn"}, {TMPL_CITE, "doi"}, {TMPL_CITE, "issue"}, {TMPL_CITE, "volume"},
+    {TMPL_CITE, "journal"}, {TMPL_CITE, "language"}, {TMPL_CITE, "archiveurl"}, {TMPL_CITE, "archivedate"},
+    {TMPL_CITE, "quote"}, {TMPL_CITE, "location"}, {TMPL_CITE, "year"}, {TMPL_CITE, "month"},
+    {TMPL_CITE, "coauthors"}, {TMPL_CITE, "editor"}, {TMPL_CITE, "format"}, {TMPL_CITE, "id"},
+    {TMPL_CITE, "newspaper"}, {TMPL_CITE, "authorlink"},
+    // {{Infobox ...}}
+    {TMPL_INFOBOX, "name"}, {TMPL_INFOBOX, "image"}, {TMPL_INFOBOX, "caption"}, {TMPL_INFOBOX, "image_caption"},
+    {TMPL_INFOBOX, "birth_date"}, {TMPL_INFOBOX, "birth_place"}, {TMPL_INFOBOX, "death_date"}, {TMPL_INFOBOX, "death_place"},
+    {TMPL_INFOBOX, "occupation"}, {TMPL_INFOBOX, "nationality"}, {TMPL_INFOBOX, "spouse"}, {TMPL_INFOBOX, "website"},
+    {TMPL_INFOBOX, "type"}, {TMPL_INFOBOX, "location"}, {TMPL_INFOBOX, "country"}, {TMPL_INFOBOX, "population"},
+    {TMPL_INFOBOX, "area"}, {TMPL_INFOBOX, "leader_name"}, {TMPL_INFOBOX, "leader_title"}, {TMPL_INFOBOX, "established"},
+    {TMPL_INFOBOX, "founded"}, {TMPL_INFOBOX, "headquarters"}, {TMPL_INFOBOX, "genre"}, {TMPL_INFOBOX, "label"},
+    {TMPL_INFOBOX, "years_active"}, {TMPL_INFOBOX, "origin"}, {TMPL_INFOBOX, "released"}, {TMPL_INFOBOX, "producer"},
+    {TMPL_INFOBOX, "length"}, {TMPL_INFOBOX, "artist"}, {TMPL_INFOBOX, "title"}, {TMPL_INFOBOX, "coordinates"}
+};
+const int TMPL_KEYS_SIZE = (int)(sizeof(TMPL_KEYS)/sizeof(TMPL_KEYS[0]));
+static_assert(sizeof(TMPL_KEYS)/sizeof(TMPL_KEYS[0]) <= TMPL_MAX_KEYS, "template codes overflow the escape byte");
+
+TemplateIndex::TemplateIndex() {
+    size_t maxKey = 0;
+    for (int i = 0; i < TMPL_KEYS_SIZE; ++i) {
+        keys[TMPL_KEYS[i].family].push_back(i);
+        size_t L = std::strlen(TMPL_KEYS[i].key); if (L > maxKey) maxKey = L;
+    }
+    maxSpan = 1 + 1 + maxKey + TMPL_MAX_PAD + 1 + 1;
+}
+
+bool sink_init(Sink& s, Method m, FILE* fout, uint64_t* total_out, Arena& arena, const CodecParams& p) {
+    s.fout = fout; s.method = m; s.total_out = total_out; s.z_inited = false; s.mem_error = false;
+    if (m == METHOD_ZLIB) {
+        size_t mark = arena_mark(arena);
+        bool own_out = !s.z_out;
+        if (own_out) { s.z_out = (unsigned char*)arena_alloc(arena, OUT_CHUNK); s.z_cap = OUT_CHUNK; }
+        if (!s.z_out) { s.z_cap = 0; s.mem_error = true; return false; }
+        s.strm.zalloc = (void*)&arena_zalloc; s.strm.zfree = (void*)&arena_zfree; s.strm.opaque = &arena;
+        int rc = hpz_deflateInit2(&s.strm, p.level, Z_DEFLATED, p.window_bits, p.mem_level, p.strategy);
+        if (rc != Z_OK) {
+            // Drop the partial deflate state (and z_out if claimed here) so a fallback gets the space back
+            arena_release(arena, mark);
+            if (own_out) { s.z_out = nullptr; s.z_cap = 0; }
+            s.mem_error = rc == Z_MEM_ERROR;
+            return false;
+        }
+        s.z_inited = true;
+    }
+    return true;
+}
+
+bool sink_write(Sink& s, const unsigned char* data, size_t n) {
+    if (!n) return true;
+    if (s.method == METHOD_STORE) {
+        if (s.fout && std::fwrite(data, 1, n, s.fout) != n) return false;
+        *s.total_out += n; return true;
+    }
+    s.strm.next_in = const_cast<unsigned char*>(data);
+    s.strm.avail_in = (uInt)n;
+    while (s.strm.avail_in > 0) {
+        s.strm.next_out = s.z_out;
+        s.strm.avail_out = (uInt)s.z_cap;
+        int r = hpz_deflate(&s.strm, Z_NO_FLUSH);
+        if (r != Z_OK) return false;
+        size_t have = s.z_cap - s.strm.avail_out;
+        if (have) {
+            if (s.fout && std::fwrite(s.z_out, 1, have, s.fout) != have) return false;
+            *s.total_out += have;
+        }
+    }
+    return true;
+}
+
+bool sink_finish(Sink& s) {
+    if (s.method == METHOD_STORE) return true;
+    for (;;) {
+        s.strm.next_out = s.z_out;
+        s.strm.avail_out = (uInt)s.z_cap;
+        int r = hpz_deflate(&s.strm, Z_FINISH);
+        if (r != Z_OK && r != Z_STREAM_END) return false;
+        size_t have = s.z_cap - s.strm.avail_out;
+        if (have) {
+            if (s.fout && std::fwrite(s.z_out, 1, have, s.fout) != have) return false;
+            *s.total_out += have;
+        }
+        if (r == Z_STREAM_END) break;
+    }
+    if (s.z_inited) { hpz_deflateEnd(&s.strm); s.z_inited = false; }
+    return true;
+}
+
+bool write_transform_header(Sink& s, uint8_t transforms) {
+    unsigned char hdr[8]; hdr[0]='H'; hdr[1]='P'; hdr[2]='Z'; hdr[3]='T'; hdr[4]=1; // version
+    // flags: bit0=DICT, bit1=SPACE-RUN, bit2=NL-RUN, bit3=DIGIT-RUN, bit4=TEMPLATE
+    hdr[5]=transforms; hdr[6]=0; hdr[7]=0;
+    return sink_write(s, hdr, sizeof(hdr));
+}
+
+static inline bool starts_with(const unsigned char* s, size_t i, size_t n, const char* t) {
+    size_t L = std::strlen(t); return i + L <= n && std::memcmp(s + i, t, L) == 0;
+}
+
+// Maintains the {{ / [[ scope stack used to decide whether a '|' opens a template parameter.
+// Only an encoder heuristic: the emitted tokens decode the same regardless of scope.
+void Encoder::track_nesting(const unsigned char* s, size_t i, size_t n) {
+    static constexpr size_t MAX_NEST = 64;
+    unsigned char c = s[i];
+    if (c == '<') { if (starts_with(s, i, n, "</text>")) nest.clear(); return; }
+    if (i + 1 >= n || s[i + 1] != c) return;
+    if (c == '{') {
+        uint8_t fam = TMPL_OTHER; size_t p = i + 2;
+        if (p < n && (s[p] | 0x20) == 'c' && (starts_with(s, p + 1, n, "ite ") || starts_with(s, p + 1, n, "ite_") || starts_with(s, p + 1, n, "itation"))) fam = TMPL_CITE;
+        else if (p < n && (s[p] | 0x20) == 'i' && starts_with(s, p + 1, n, "nfobox")) fam = TMPL_INFOBOX;
+        if (nest.size() < MAX_NEST) nest.push_back(fam);
+    } else if (c == '}') {
+        while (!nest.empty()) { uint8_t top = nest.back(); nest.pop_back(); if (top != TMPL_LINK) break; }
+    } else if (c == '[') {
+        if (nest.size() < MAX_NEST) nest.push_back(TMPL_LINK);
+    } else if (c == ']') {
+        if (!nest.empty() && nest.back() == TMPL_LINK) nest.pop_back();
+    }
+}
+
+// At a '|' directly inside a cite/infobox template, fold "| key<pad> = " into one code plus a
+// layout byte. Returns the number of input bytes consumed (0 -> no match).
+size_t Encoder::match_template_param(const unsigned char* s, size_t i, size_t n) {
+    if (nest.empty() || (nest.back() != TMPL_CITE && nest.back() != TMPL_INFOBOX)) return 0;
+    size_t p = i + 1;
+    unsigned lead = (p < n && s[p] == ' ') ? 1u : 0u; p += lead;
+    size_t k0 = p;
+    while (p < n && ((s[p] >= 'a' && s[p] <= 'z') || (s[p] >= 'A' && s[p] <= 'Z') || (s[p] >= '0' && s[p] <= '9') || s[p] == '_' || s[p] == '-')) ++p;
+    size_t klen = p - k0; if (!klen) return 0;
+    size_t pad = 0; while (p < n && s[p] == ' ' && pad <= TMPL_MAX_PAD) { ++p; ++pad; }
+    if (pad > TMPL_MAX_PAD || p >= n || s[p] != '=') return 0;
+    ++p;
+    unsigned trail = (p < n && s[p] == ' ') ? 1u : 0u; p += trail;
+    for (int ki : tidx.keys[nest.back()]) {
+        const char* key = TMPL_KEYS[ki].key;
+        if (std::strlen(key) == klen && std::memcmp(s + k0, key, klen) == 0) {
+            unsigned layout = lead | (trail << 1) | ((unsigned)pad << 2);
+            if (layout == 0) { emit_token((uint8_t)(TMPL_BARE_BASE + ki)); return p - i; }
+            emit_token((uint8_t)(TMPL_CODE_BASE + ki)); emit_byte((unsigned char)layout);
+            return p - i;
+        }
+    }
+    return 0;
+}
+
+void Encoder::process_block(const unsigned char* data, size_t n, bool final) {
+    if (n > max_chunk) { std::fprintf(stderr, "[ERROR] Transform input chunk of %zu bytes exceeds %zu\n", n, max_chunk); std::exit(1); }
+    if (data && n) std::memcpy(block + carry_len, data, n);
+    const size_t bn = carry_len + n; carry_len = 0;
+    size_t look = lookahead();
+    // Chunks shorter than the lookahead are carried whole so matches can still span them
+    if (!final && bn < look) { carry_len = bn; return; }
+    size_t reserve = final ? 0 : look - 1;
+    size_t limit = bn - reserve;
+    const unsigned char* s = block;
+    // A run reaching the block end may continue in the next chunk: emit only its whole
+    // max-length tokens and carry the rest, so the tokens match a single-chunk encode
+    size_t i = 0;
+    auto run_end = [&](size_t j, size_t max_tok) { return (j == bn && !final) ? i + (j - i) / max_tok * max_tok : j; };
+    while (i < limit) {
+        unsigned char c = s[i];
+        if (c == 0x00) { emit_byte(0x00); emit_byte(0x00); ++i; continue; }
+        // Template scope tracking and parameter folding
+        bool bracket_pair = false;
+        if (flags & TF_TEMPLATE) {
+            if (c == '{' || c == '}' || c == '[' || c == ']' || c == '<') {
+                track_nesting(s, i, bn);
+                bracket_pair = c != '<' && i + 1 < bn && s[i + 1] == c;
+            } else if (c == '|') {
+                size_t used = match_template_param(s, i, bn);
+                if (used) { i += used; continue; }
+            }
+        }
+        // Dictionary match (longest first per head index)
+        if (flags & TF_DICT) {
+            const auto& cand = idx.heads[c];
+            bool matched = false;
+            for (int di : cand) {
+                const char* t = DICT[di]; size_t L = std::strlen(t);
+                if (i + L <= bn && std::memcmp(s + i, t, L) == 0) {
+                    emit_token((uint8_t)(di + 1)); i += L; matched = true; break;
+                }
+            }
+            if (matched) continue;
+        }
+        // A bracket pair already counted by track_nesting must not be seen again at i+1
+        if (bracket_pair) { emit_byte(c); emit_byte(c); i += 2; continue; }
+        // Space-run
+        if (c == ' ' && (flags & TF_SPACE)) {
+            size_t j = i; while (j < bn && s[j] == ' ') ++j; j = run_end(j, SPACE_RUN_MAX); size_t run = j - i;
+            if (run >= 4) { emit_spaces(run); i = j; continue; }
+        }
+        // Newline-run
+        if (c == '\n' && (flags & TF_NL)) {
+            size_t j = i; while (j < bn && s[j] == '\n') ++j; j = run_end(j, NL_RUN_MAX); size_t run = j - i;
+            if (run >= 2) { emit_newlines(run); i = j; continue; }
+        }
+        // Digit-run (0-9)
+        if (c >= '0' && c <= '9' && (flags & TF_DIGIT)) {
+            size_t j = i; while (j < bn && s[j] >= '0' && s[j] <= '9') ++j; j = run_end(j, DIGIT_RUN_MAX); size_t run = j - i;
+            if (run >= 3) { emit_digits_run(s + i, run); i = j; continue; }
+        }
+        // Literal
+        emit_byte(c); ++i;
+    }
+    // Save carry; a dictionary match may have consumed past limit into the reserve
+    if (!final && i < bn) { carry_len = bn - i; std::memmove(block, block + i, carry_len); }
+}
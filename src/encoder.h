@@ -0,0 +1,161 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "dlz.h"
+#include "arena.h"
+
+static constexpr size_t IN_CHUNK  = 1 << 20; // 1 MiB
+static constexpr size_t OUT_CHUNK = 1 << 20; // 1 MiB
+static constexpr size_t TBUF_FLUSH = 1 << 16; // 64 KiB
+// Longest run each run token can carry (length byte 0..255 plus the run's minimum)
+static constexpr size_t SPACE_RUN_MAX = 259, NL_RUN_MAX = 257, DIGIT_RUN_MAX = 258;
+
+enum Method : uint8_t { METHOD_STORE = 0, METHOD_ZLIB = 1 };
+
+// HPZT header flag bits (hdr[5]); also selects which transforms the Encoder applies
+enum TransformFlags : uint8_t {
+    TF_DICT = 0x01, TF_SPACE = 0x02, TF_NL = 0x04, TF_DIGIT = 0x08, TF_TEMPLATE = 0x10,
+    TF_ALL = 0x1F
+};
+
+// Tunables shared by comp and the sweep driver; defaults match the shipped archive format
+struct CodecParams {
+    int level = 9;
+    int window_bits = 15;
+    int mem_level = 9;
+    int strategy = 0;
+    size_t tbuf_flush = TBUF_FLUSH;
+    size_t in_chunk = IN_CHUNK;
+    uint8_t transforms = TF_ALL; // 0 -> raw passthrough, no HPZT header
+};
+
+extern const char* const DICT[];
+extern const int DICT_SIZE;
+
+struct DictIndex {
+    std::vector<int> heads[256];
+    size_t maxLen = 0;
+    DictIndex();
+};
+
+// Template families tracked by the TF_TEMPLATE transform; TMPL_LINK only marks [[...]] nesting
+enum TemplateFamily : uint8_t { TMPL_OTHER = 0, TMPL_CITE = 1, TMPL_INFOBOX = 2, TMPL_LINK = 3 };
+
+struct TemplateKey { uint8_t family; const char* key; };
+extern const TemplateKey TMPL_KEYS[];
+extern const int TMPL_KEYS_SIZE;
+static constexpr uint8_t TMPL_CODE_BASE = 0x83; // followed by a layout byte
+static constexpr int TMPL_MAX_KEYS = 62;
+static constexpr uint8_t TMPL_BARE_BASE = TMPL_CODE_BASE + TMPL_MAX_KEYS; // layout 0 ("|key="), no layout byte
+static constexpr size_t TMPL_MAX_PAD = 63; // spaces between key and '=' that fit the layout byte
+
+struct TemplateIndex {
+    std::vector<int> keys[3]; // TMPL_KEYS ids per family
+    size_t maxSpan = 0;       // longest "| key<pad> = " the encoder can fold
+    TemplateIndex();
+};
+
+// fout == nullptr -> count-only sink (bytes are accounted in *total_out but not written)
+// z_out and the deflate state are allocated from the arena passed to sink_init
+struct Sink {
+    FILE* fout{};
+    Method method{METHOD_STORE};
+    z_stream strm{};
+    unsigned char* z_out{};
+    size_t z_cap{};
+    uint64_t* total_out{};
+    bool z_inited{false};
+    bool mem_error{false}; // last sink_init failed because the arena cap was hit
+};
+
+// On failure the arena is released to where it stood on entry and s.mem_error tells a cap
+// failure apart from a codec one
+bool sink_init(Sink& s, Method m, FILE* fout, uint64_t* total_out, Arena& arena, const CodecParams& p = CodecParams());
+bool sink_write(Sink& s, const unsigned char* data, size_t n);
+bool sink_finish(Sink& s);
+bool write_transform_header(Sink& s, uint8_t transforms);
+
+// Reversible transform encoder with streaming output to sink
+// Tokens: 0x00 0x00 -> literal 0x00; 0x00 1..DICT_SIZE -> dictionary id
+//         0x00 0x80 <L> -> space run of length (L+4)
+//         0x00 0x81 <L> -> newline run of length (L+2)
+//         0x00 0x82 <L> <digits...> -> digit run of length (L+3) followed by that many digit bytes
+//         0x00 0x83+k <Y> -> template parameter TMPL_KEYS[k]: '|' [' ' if Y&1] key [Y>>2 spaces] '=' [' ' if Y&2]
+//         0x00 0xC1+k -> template parameter TMPL_KEYS[k] with layout 0: '|' key '='
+struct Encoder {
+    DictIndex idx;
+    TemplateIndex tidx;
+    std::vector<uint8_t> nest; // open {{ / [[ scopes, innermost last
+    // Fixed arena buffers: block holds carry + one input chunk, tbuf never exceeds flush_at
+    unsigned char* block = nullptr;
+    size_t block_cap = 0, carry_len = 0;
+    unsigned char* tbuf = nullptr;
+    size_t tbuf_len = 0;
+    Sink* sink;
+    size_t flush_at, max_chunk;
+    uint8_t flags;
+    Encoder(Sink* s, const CodecParams& p = CodecParams())
+        : sink(s), flush_at(p.tbuf_flush ? p.tbuf_flush : 1), max_chunk(p.in_chunk), flags(p.transforms) {}
+    // Bytes a token may need past its start: longest dictionary entry, template span or run token
+    size_t lookahead() const { return std::max({idx.maxLen, tidx.maxSpan, SPACE_RUN_MAX}); }
+    // Allocates block and tbuf; false when they do not fit under the arena cap
+    bool init(Arena& arena) {
+        block_cap = max_chunk + lookahead();
+        block = (unsigned char*)arena_alloc(arena, block_cap);
+        tbuf = (unsigned char*)arena_alloc(arena, flush_at);
+        return block && tbuf;
+    }
+    void flush_tbuf() {
+        if (tbuf_len) {
+            if (!sink_write(*sink, tbuf, tbuf_len)) { std::fprintf(stderr, "[ERROR] sink_write failed while flushing transform buffer\n"); std::exit(1); }
+            tbuf_len = 0;
+        }
+    }
+    inline void emit_byte(unsigned char b) {
+        tbuf[tbuf_len++] = b;
+        if (tbuf_len >= flush_at) flush_tbuf();
+    }
+    inline void emit_data(const unsigned char* p, size_t n) {
+        if (n == 0) return;
+        if (tbuf_len + n >= flush_at) flush_tbuf();
+        if (n >= flush_at) {
+            if (!sink_write(*sink, p, n)) { std::fprintf(stderr, "[ERROR] sink_write failed\n"); std::exit(1); }
+        } else {
+            std::memcpy(tbuf + tbuf_len, p, n); tbuf_len += n;
+        }
+    }
+    inline void emit_token(uint8_t id) { emit_byte(0x00); emit_byte(id); }
+    inline void emit_spaces(size_t n) {
+        while (n >= SPACE_RUN_MAX) { emit_byte(0x00); emit_byte(0x80); emit_byte((unsigned char)(255)); n -= SPACE_RUN_MAX; }
+        if (n >= 4) { emit_byte(0x00); emit_byte(0x80); emit_byte((unsigned char)(n - 4)); }
+        else { for (size_t i = 0; i < n; ++i) emit_byte(' '); }
+    }
+    inline void emit_newlines(size_t n) {
+        while (n >= NL_RUN_MAX) { emit_byte(0x00); emit_byte(0x81); emit_byte((unsigned char)(255)); n -= NL_RUN_MAX; }
+        if (n >= 2) { emit_byte(0x00); emit_byte(0x81); emit_byte((unsigned char)(n - 2)); }
+        else { for (size_t i = 0; i < n; ++i) emit_byte('\n'); }
+    }
+    inline void emit_digits_run(const unsigned char* s, size_t n) {
+        // Encode runs >=3 as 0x00 0x82 (len-3) + digits (n bytes). Saves 1 byte for any n>=3.
+        while (n >= 3) {
+            size_t chunk = n;
+            if (chunk > DIGIT_RUN_MAX) chunk = DIGIT_RUN_MAX; // length byte max 255 -> len-3<=255 => len<=258
+            emit_byte(0x00); emit_byte(0x82); emit_byte((unsigned char)(chunk - 3));
+            emit_data(s, chunk);
+            s += chunk; n -= chunk;
+        }
+        // leftovers <3
+        for (size_t i = 0; i < n; ++i) emit_byte(s[i]);
+    }
+    void track_nesting(const unsigned char* s, size_t i, size_t n);
+    size_t match_template_param(const unsigned char* s, size_t i, size_t n);
+    void process_block(const unsigned char* data, size_t n, bool final);
+};
+
+#endif
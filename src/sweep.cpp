@@ -0,0 +1,261 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <sys/stat.h>
+#include "encoder.h"
+
+// In-process parameter sweep over CodecParams: every grid point is run over the same input
+// slices with the comp Encoder/Sink (count-only sink), tasks are scheduled on a work-stealing
+// pool, and results are written as a CSV ranked by compressed size. Each worker allocates
+// from its own slice of the capped arena, so mem_bytes is the measured arena high-water mark.
+
+struct Grid {
+    std::vector<long> level{9}, wbits{15}, memlevel{9}, strategy{0}, tbuf{(long)TBUF_FLUSH}, chunk{(long)IN_CHUNK}, transforms{TF_ALL};
+};
+
+struct Slice { unsigned char* data = nullptr; size_t size = 0; };
+
+struct TaskResult { uint64_t out_bytes = 0, cpu_ns = 0, mem_bytes = 0; bool ok = false; };
+
+struct ConfigResult { CodecParams p; uint64_t in_bytes = 0, out_bytes = 0, cpu_ns = 0, mem_bytes = 0; bool ok = true; };
+
+static void print_usage(const char* argv0) {
+    std::fprintf(stderr,
+        "Usage: %s [--grid=SPEC] [--slices=N] [--slice-size=BYTES] [--threads=N] [--mem-cap=BYTES] [--csv=PATH] <input>\n"
+        "  SPEC: ';'-separated key=v1,v2,... with keys level, wbits, memlevel, strategy, tbuf, chunk, transforms\n"
+        "        values may be ranges (lo-hi) and take k/m suffixes, e.g. \"level=6-9;memlevel=8,9;tbuf=16k,64k;transforms=0,15\"\n",
+        argv0);
+}
+
+static bool parse_num(const std::string& t, long& v) {
+    if (t.empty()) return false;
+    char* end = nullptr; errno = 0;
+    long x = std::strtol(t.c_str(), &end, 0);
+    if (errno || end == t.c_str()) return false;
+    if (*end == 'k' || *end == 'K') { x <<= 10; ++end; }
+    else if (*end == 'm' || *end == 'M') { x <<= 20; ++end; }
+    if (*end) return false;
+    v = x; return true;
+}
+
+static bool parse_values(const std::string& list, std::vector<long>& out) {
+    out.clear();
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = list.find(',', pos); if (comma == std::string::npos) comma = list.size();
+        std::string item = list.substr(pos, comma - pos);
+        size_t dash = item.find('-', 1);
+        long lo, hi;
+        if (dash != std::string::npos) {
+            if (!parse_num(item.substr(0, dash), lo) || !parse_num(item.substr(dash + 1), hi) || hi < lo || hi - lo > 4096) return false;
+            for (long v = lo; v <= hi; ++v) out.push_back(v);
+        } else {
+            if (!parse_num(item, lo)) return false;
+            out.push_back(lo);
+        }
+        pos = comma + 1;
+    }
+    return !out.empty();
+}
+
+static bool parse_grid(const std::string& spec, Grid& g) {
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t semi = spec.find(';', pos); if (semi == std::string::npos) semi = spec.size();
+        std::string kv = spec.substr(pos, semi - pos); pos = semi + 1;
+        if (kv.empty()) continue;
+        size_t eq = kv.find('='); if (eq == std::string::npos) { std::fprintf(stderr, "[ERROR] Grid entry without '=': %s\n", kv.c_str()); return false; }
+        std::string key = kv.substr(0, eq);
+        std::vector<long>* dst = nullptr; long lo = 0, hi = 0;
+        if (key == "level") { dst = &g.level; lo = 0; hi = 9; }
+        else if (key == "wbits") { dst = &g.wbits; lo = 9; hi = 15; }
+        else if (key == "memlevel") { dst = &g.memlevel; lo = 1; hi = 9; }
+        else if (key == "strategy") { dst = &g.strategy; lo = 0; hi = 4; }
+        else if (key == "tbuf") { dst = &g.tbuf; lo = 1; hi = 1L << 30; }
+        else if (key == "chunk") { dst = &g.chunk; lo = 1; hi = 1L << 30; }
+        else if (key == "transforms") { dst = &g.transforms; lo = 0; hi = TF_ALL; }
+        else { std::fprintf(stderr, "[ERROR] Unknown grid key: %s\n", key.c_str()); return false; }
+        if (!parse_values(kv.substr(eq + 1), *dst)) { std::fprintf(stderr, "[ERROR] Bad values for %s\n", key.c_str()); return false; }
+        for (long v : *dst) if (v < lo || v > hi) { std::fprintf(stderr, "[ERROR] %s=%ld out of range [%ld,%ld]\n", key.c_str(), v, lo, hi); return false; }
+    }
+    return true;
+}
+
+static std::vector<CodecParams> expand_grid(const Grid& g) {
+    std::vector<CodecParams> out;
+    for (long lv : g.level) for (long wb : g.wbits) for (long ml : g.memlevel) for (long st : g.strategy)
+    for (long tb : g.tbuf) for (long ch : g.chunk) for (long tf : g.transforms) {
+        CodecParams p; p.level = (int)lv; p.window_bits = (int)wb; p.mem_level = (int)ml; p.strategy = (int)st;
+        p.tbuf_flush = (size_t)tb; p.in_chunk = (size_t)ch; p.transforms = (uint8_t)tf;
+        out.push_back(p);
+    }
+    return out;
+}
+
+static uint64_t thread_cpu_ns() {
+    struct timespec ts{}; clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static TaskResult run_one(const CodecParams& p, Method method, const Slice& sl, Arena& arena) {
+    TaskResult r; uint64_t out = 0;
+    uint64_t t0 = thread_cpu_ns();
+    Sink sink{};
+    if (!sink_init(sink, method, nullptr, &out, arena, p)) return r;
+    const unsigned char* d = sl.data; size_t n = sl.size;
+    if (p.transforms) {
+        if (!write_transform_header(sink, p.transforms)) return r;
+        Encoder enc(&sink, p);
+        if (!enc.init(arena)) return r;
+        for (size_t off = 0; off < n; off += p.in_chunk) enc.process_block(d + off, std::min(p.in_chunk, n - off), false);
+        enc.process_block(nullptr, 0, true); enc.flush_tbuf();
+    } else {
+        for (size_t off = 0; off < n; off += p.in_chunk) if (!sink_write(sink, d + off, std::min(p.in_chunk, n - off))) return r;
+    }
+    if (!sink_finish(sink)) return r;
+    r.cpu_ns = thread_cpu_ns() - t0; r.out_bytes = out; r.ok = true;
+    return r;
+}
+
+// Work-stealing pool: each worker owns a deque seeded with a contiguous run of task ids,
+// pops from its own back and steals from the front of the others once it runs dry.
+struct StealQueue { std::mutex m; std::deque<size_t> q; };
+
+// fn(worker, task)
+template <class Fn>
+static void run_pool(size_t nthreads, size_t ntasks, Fn fn) {
+    std::vector<StealQueue> queues(nthreads);
+    for (size_t w = 0; w < nthreads; ++w) {
+        size_t lo = ntasks * w / nthreads, hi = ntasks * (w + 1) / nthreads;
+        for (size_t t = lo; t < hi; ++t) queues[w].q.push_back(t);
+    }
+    auto worker = [&](size_t self) {
+        for (;;) {
+            size_t task = 0; bool got = false;
+            {
+                std::lock_guard<std::mutex> lk(queues[self].m);
+                if (!queues[self].q.empty()) { task = queues[self].q.back(); queues[self].q.pop_back(); got = true; }
+            }
+            for (size_t k = 1; !got && k < nthreads; ++k) {
+                StealQueue& v = queues[(self + k) % nthreads];
+                std::lock_guard<std::mutex> lk(v.m);
+                if (!v.q.empty()) { task = v.q.front(); v.q.pop_front(); got = true; }
+            }
+            if (!got) return; // no task spawns new work, so empty everywhere means done
+            fn(self, task);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t w = 1; w < nthreads; ++w) threads.emplace_back(worker, w);
+    worker(0);
+    for (auto& t : threads) t.join();
+}
+
+static bool load_slices(const char* path, size_t count, size_t size, Arena& arena, std::vector<Slice>& out) {
+    struct stat st{}; if (stat(path, &st) != 0) { std::fprintf(stderr, "[ERROR] Cannot stat input: %s (%s)\n", path, std::strerror(errno)); return false; }
+    uint64_t fsz = (uint64_t)st.st_size;
+    if (fsz == 0) { std::fprintf(stderr, "[ERROR] Input is empty: %s\n", path); return false; }
+    if (size >= fsz) { size = (size_t)fsz; count = 1; }
+    FILE* f = std::fopen(path, "rb"); if (!f) { std::fprintf(stderr, "[ERROR] Cannot open input: %s (%s)\n", path, std::strerror(errno)); return false; }
+    out.resize(count);
+    for (size_t k = 0; k < count; ++k) {
+        uint64_t off = count > 1 ? (fsz - size) * k / (count - 1) : 0;
+        out[k].data = (unsigned char*)arena_alloc(arena, size); out[k].size = size;
+        if (!out[k].data) { std::fprintf(stderr, "[ERROR] Memory cap exceeded loading %zu slices of %zu bytes\n", count, size); std::fclose(f); return false; }
+        if (fseeko(f, (off_t)off, SEEK_SET) != 0 || std::fread(out[k].data, 1, size, f) != size) {
+            std::fprintf(stderr, "[ERROR] Reading slice %zu failed (%s)\n", k, std::strerror(errno)); std::fclose(f); return false;
+        }
+    }
+    std::fclose(f);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Grid grid; size_t nslices = 8, slice_size = 16u << 20, nthreads = std::thread::hardware_concurrency();
+    uint64_t mem_cap = ARENA_DEFAULT_CAP;
+    const char* csv_path = nullptr;
+    int argi = 1;
+    for (; argi < argc - 1; ++argi) {
+        const char* a = argv[argi]; long v = 0;
+        if (std::strncmp(a, "--grid=", 7) == 0) { if (!parse_grid(a + 7, grid)) return 2; continue; }
+        if (std::strncmp(a, "--slices=", 9) == 0) { if (!parse_num(a + 9, v) || v < 1) { print_usage(argv[0]); return 2; } nslices = (size_t)v; continue; }
+        if (std::strncmp(a, "--slice-size=", 13) == 0) { if (!parse_num(a + 13, v) || v < 1) { print_usage(argv[0]); return 2; } slice_size = (size_t)v; continue; }
+        if (std::strncmp(a, "--threads=", 10) == 0) { if (!parse_num(a + 10, v) || v < 1) { print_usage(argv[0]); return 2; } nthreads = (size_t)v; continue; }
+        if (std::strncmp(a, "--mem-cap=", 10) == 0) { if (!parse_num(a + 10, v) || v < 1) { print_usage(argv[0]); return 2; } mem_cap = (uint64_t)v; continue; }
+        if (std::strncmp(a, "--csv=", 6) == 0) { csv_path = a + 6; continue; }
+        print_usage(argv[0]); return 2;
+    }
+    if (argc - argi != 1) { print_usage(argv[0]); return 2; }
+    if (nthreads == 0) nthreads = 1;
+
+    // Resolve zlib once up front; the loader is not safe to race from worker threads
+    Method method = dlz_available() ? METHOD_ZLIB : METHOD_STORE;
+    if (method == METHOD_STORE) std::fprintf(stderr, "[WARN] zlib not available at runtime; sweeping STORE sizes only.\n");
+
+    if (!arena_init(g_arena, mem_cap)) { std::fprintf(stderr, "[ERROR] Cannot reserve %llu byte arena\n", (unsigned long long)mem_cap); return 1; }
+    std::vector<Slice> slices;
+    if (!load_slices(argv[argi], nslices, slice_size, g_arena, slices)) return 1;
+    nslices = slices.size();
+
+    // Split what is left of the cap evenly into per-worker sub-arenas
+    std::vector<Arena> arenas(nthreads);
+    size_t per_worker = ((g_arena.cap - g_arena.used) / nthreads) & ~(ARENA_ALIGN - 1);
+    for (auto& a : arenas) if (!arena_init_sub(a, g_arena, per_worker)) { std::fprintf(stderr, "[ERROR] Cannot carve %zu byte worker arenas\n", per_worker); return 1; }
+
+    std::vector<CodecParams> configs = expand_grid(grid);
+    size_t ntasks = configs.size() * nslices;
+    std::vector<TaskResult> results(ntasks);
+    std::fprintf(stderr, "[INFO] %zu configs x %zu slices (%zu bytes each) on %zu threads\n", configs.size(), nslices, slices[0].size, nthreads);
+
+    run_pool(nthreads, ntasks, [&](size_t w, size_t t) {
+        Arena& a = arenas[w];
+        size_t mark = arena_mark(a); arena_reset_peak(a);
+        results[t] = run_one(configs[t / nslices], method, slices[t % nslices], a);
+        results[t].mem_bytes = a.peak - mark;
+        arena_release(a, mark);
+    });
+
+    std::vector<ConfigResult> rows(configs.size());
+    for (size_t c = 0; c < configs.size(); ++c) {
+        ConfigResult& r = rows[c]; r.p = configs[c];
+        for (size_t k = 0; k < nslices; ++k) {
+            const TaskResult& tr = results[c * nslices + k];
+            if (!tr.ok) r.ok = false;
+            r.in_bytes += slices[k].size; r.out_bytes += tr.out_bytes; r.cpu_ns += tr.cpu_ns;
+            r.mem_bytes = std::max(r.mem_bytes, tr.mem_bytes);
+        }
+        if (!r.ok) std::fprintf(stderr, "[WARN] Config %zu failed (level=%d wbits=%d memlevel=%d chunk=%zu; init error or over the per-worker memory cap); omitted from ranking\n", c, r.p.level, r.p.window_bits, r.p.mem_level, r.p.in_chunk);
+    }
+    rows.erase(std::remove_if(rows.begin(), rows.end(), [](const ConfigResult& r){ return !r.ok; }), rows.end());
+    std::stable_sort(rows.begin(), rows.end(), [](const ConfigResult& a, const ConfigResult& b){
+        return a.out_bytes != b.out_bytes ? a.out_bytes < b.out_bytes : a.cpu_ns < b.cpu_ns;
+    });
+
+    FILE* fcsv = csv_path ? std::fopen(csv_path, "w") : stdout;
+    if (!fcsv) { std::fprintf(stderr, "[ERROR] Cannot create CSV: %s (%s)\n", csv_path, std::strerror(errno)); return 1; }
+    std::fprintf(fcsv, "rank,level,window_bits,mem_level,strategy,tbuf_flush,in_chunk,transforms,in_bytes,out_bytes,ratio,cpu_ms,mem_bytes\n");
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const ConfigResult& r = rows[i];
+        std::fprintf(fcsv, "%zu,%d,%d,%d,%d,%zu,%zu,0x%02x,%llu,%llu,%.6f,%.3f,%llu\n",
+            i + 1, r.p.level, r.p.window_bits, r.p.mem_level, r.p.strategy, r.p.tbuf_flush, r.p.in_chunk, (unsigned)r.p.transforms,
+            (unsigned long long)r.in_bytes, (unsigned long long)r.out_bytes, r.in_bytes ? (double)r.out_bytes / (double)r.in_bytes : 0.0,
+            (double)r.cpu_ns / 1e6, (unsigned long long)r.mem_bytes);
+    }
+    if (csv_path && std::fclose(fcsv) != 0) { std::fprintf(stderr, "[ERROR] Closing CSV failed (%s)\n", std::strerror(errno)); return 1; }
+
+    if (!rows.empty()) {
+        const ConfigResult& b = rows[0];
+        std::fprintf(stderr, "[OK] Best: level=%d wbits=%d memlevel=%d strategy=%d tbuf=%zu chunk=%zu transforms=0x%02x -> %llu bytes\n",
+            b.p.level, b.p.window_bits, b.p.mem_level, b.p.strategy, b.p.tbuf_flush, b.p.in_chunk, (unsigned)b.p.transforms, (unsigned long long)b.out_bytes);
+    }
+    return rows.empty() ? 1 : 0;
+}